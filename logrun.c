@@ -37,7 +37,14 @@
 
 typedef long long ustime_t;
 
+/* largest value of a signed integer type */
+#define SIGNED_MAX(t) \
+    ((((unsigned long long)1 << (sizeof(t) * CHAR_BIT - 2)) - 1) * 2 + 1)
+
 #include "logrun_config.h"
+#ifdef HAVE_F_SETPIPE_SZ
+#define _GNU_SOURCE /* for F_SETPIPE_SZ */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,16 +64,31 @@ typedef long long ustime_t;
 #include <errno.h>
 #include <sys/select.h>
 #include <sys/wait.h>
+#ifdef HAVE_IOPRIO_SET
+#include <sys/syscall.h>
+#endif
 
 /* some hard coded values */
 static const char *progname = "logrun"; /* program name, for messages */
 static const char *dir1 = "LOGRUN_DIR"; /* env variable holding directory */
 static const char *dir2 = "logs"; /* under $HOME if that's not specified */
 static const char *opfx = "Out_"; /* prefix for output file names */
+static const char *msfx = ".json"; /* suffix for manifest file names */
 static const char *bar = "===================================="
                          "====================================";
 static const char *shell = "/bin/sh"; /* shell to run commands */
 static const int wait_reap = 50000; /* microseconds to wait for children */
+static const char *gclock = ".logrun_gc"; /* lock & timestamp for cleanup */
+static const char *gcage = "LOGRUN_MAX_AGE"; /* env: remove after (days) */
+static const char *gcsize = "LOGRUN_MAX_SIZE"; /* env: total size budget */
+static const char *gcpack = "LOGRUN_PACK_AGE"; /* env: pack after (days) */
+static const char *gzip = "gzip"; /* compressor used when packing */
+static const int gc_interval = 3600; /* seconds between automatic cleanups */
+static const int gc_stale = 86400; /* seconds until unfinished manifest's old */
+static const char *pipesz = "LOGRUN_PIPE_SIZE"; /* env: max pipe capacity */
+static const int relay_min = 4096; /* smallest read when relaying output */
+static const int relay_patience = 16; /* small reads before using less */
+static const unsigned long long pipe_dflt = 1 << 20; /* w/o $LOGRUN_PIPE_SIZE */
 
 /* help message */
 static void
@@ -74,15 +96,19 @@ usage(void)
 {
     fprintf(stderr,
         "Usage: %s [options] command\n"
+        "       %s -C [-d dir]\n"
         "Options:\n"
         "\t-d dir -- place output files in this directory; if not set,\n"
         "\t          this program uses $LOGRUN_DIR, or failing that\n"
         "\t          $HOME/logs/, or failing that the current directory.\n"
         "\t-g -- every 5 minutes print time statistics; -gg for more frequent\n"
+        "\t-C -- instead of running a command, clean up the output directory\n"
+        "\t      as configured by $%s,\n"
+        "\t      $%s and $%s\n"
         "\t-x -- instead of passing 'command' through the shell (%s),\n"
         "\t      treat it as an executable file name and arguments\n"
         "Version: %s\n",
-        progname, shell,
+        progname, progname, gcage, gcsize, gcpack, shell,
         LOGRUN_VERSION);
 #ifdef LOGRUN_SRC_HASH
 #ifdef LOGRUN_SRC_HASH_ALGO
@@ -123,6 +149,61 @@ dirok(const char *path)
     return(1);
 }
 
+/* envnum(): Parse a number from environment variable 'var' into *val.
+ * If 'sized' is nonzero the number may have a suffix of K, M or G.  It
+ * may be no more than 'max'.  Returns 1 if it was set, 0 if it wasn't,
+ * negative if it was invalid.
+ */
+static int
+envnum(const char *var, int sized, unsigned long long max,
+       unsigned long long *val)
+{
+    const char *s = getenv(var);
+    char *e = NULL;
+    unsigned long long v;
+    int shift = 0;
+
+    if (!s || !*s) return(0);
+    errno = 0;
+    v = strtoull(s, &e, 10);
+    if (sized && e && *e) {
+        switch (*e) {
+        case 'k': case 'K': shift = 10; ++e; break;
+        case 'm': case 'M': shift = 20; ++e; break;
+        case 'g': case 'G': shift = 30; ++e; break;
+        }
+    }
+    /* strtoull() would quietly negate a leading '-' */
+    if (errno || e == s || *e || strchr(s, '-') ||
+        v > (ULLONG_MAX >> shift) || (v << shift) > max) {
+        fprintf(stderr, "%s: invalid value for $%s: %s\n", progname, var, s);
+        return(-1);
+    }
+    *val = v << shift;
+    return(1);
+}
+
+/* fdlock(): Place an advisory lock of the given type (F_RDLCK or F_WRLCK)
+ * on the whole of an open file.  If 'wait' is nonzero, waits until it can
+ * be had; otherwise fails right away if something else holds a lock.
+ * Returns 0 on success, negative on failure.
+ */
+static int
+fdlock(int fd, int type, int wait)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0; /* whole file */
+    while (fcntl(fd, wait ? F_SETLKW : F_SETLK, &fl) < 0) {
+        if (!wait || errno != EINTR) return(-1);
+    }
+    return(0);
+}
+
 /* mkfile(): Pick an unused file name and create that file for writing.
  * Filename takes the following form:
  *      Out_YYMMDD_NN
@@ -213,6 +294,20 @@ mkfile(const char *dir, char **path, FILE **fp)
 #error "need to code an alternative for fopen('x')/fdopen()"
 #endif
 
+    /* Lock the file for as long as we're writing it, so cleanup (gc_run())
+     * leaves it alone.  If cleanup removed it in the moment before we got
+     * the lock, start over.  If locks don't work here at all, do without.
+     */
+    if (fdlock(fileno(*fp), F_WRLCK, 1) >= 0) {
+        struct stat sb;
+
+        if (fstat(fileno(*fp), &sb) >= 0 && sb.st_nlink == 0) {
+            fclose(*fp);
+            free(*path);
+            return(mkfile(dir, path, fp));
+        }
+    }
+
     return(0);
 }
 
@@ -337,15 +432,970 @@ int spacepaste(char *buf, int buflen, char **argv, int argc)
     }
 }
 
+/* Cleanup of the output directory, "gc" for short.  It's configured with
+ * environment variables (see gc_getconf()) and happens either on request
+ * ("-C") or in the background after a command has run.  It only touches
+ * files named like logrun's own, and never an output file which some
+ * running logrun holds locked (see mkfile()).
+ *
+ * Old output files can be "packed": compressed with gzip and appended to
+ * a per-day archive, Out_YYMMDD.gz, which zcat & zgrep can still read
+ * as a whole.  Next to it, Out_YYMMDD.idx gets a tab separated line for
+ * each file packed:
+ *      name offset length size mtime command
+ * giving where its compressed form is in the archive, so a single file
+ * can be extracted with tail, head & gunzip.
+ */
+
+/* gcconf: cleanup settings; zero means "don't" */
+struct gcconf {
+    time_t maxage; /* remove files older than this many seconds */
+    off_t maxsize; /* remove oldest files until total is no more than this */
+    time_t packafter; /* pack output files older than this many seconds */
+};
+
+/* gcent: a file (or archive) in the output directory */
+struct gcent {
+    char *name; /* file name; for an archive, without ".gz" or ".idx" */
+    int archive; /* 1 for an archive, 0 for an output file or manifest */
+    int manifest; /* 1 for a manifest */
+    unsigned day; /* YYMMDD from the name */
+    time_t when; /* mtime; or for an archive, the end of its day */
+    off_t size; /* size in bytes; for an archive, of both its files */
+    int gone; /* set once it's been removed or packed */
+};
+
+/* gc_getconf(): Fill in 'conf' from the environment.  Returns positive
+ * if there's any cleanup to do, zero if none, negative on error.
+ */
+static int
+gc_getconf(struct gcconf *conf)
+{
+    unsigned long long v;
+    int any = 0, rv;
+
+    memset(conf, 0, sizeof *conf);
+    if ((rv = envnum(gcage, 0, SIGNED_MAX(time_t) / 86400, &v)) < 0) {
+        return(-1);
+    }
+    if (rv && v) { conf->maxage = (time_t)v * 86400; any = 1; }
+    if ((rv = envnum(gcsize, 1, SIGNED_MAX(off_t), &v)) < 0) return(-1);
+    if (rv && v) { conf->maxsize = (off_t)v; any = 1; }
+    if ((rv = envnum(gcpack, 0, SIGNED_MAX(time_t) / 86400, &v)) < 0) {
+        return(-1);
+    }
+    if (rv && v) { conf->packafter = (time_t)v * 86400; any = 1; }
+    return(any);
+}
+
+/* gc_parse(): Recognize the name of a file in the output directory.
+ * Returns 1 for an output file (Out_YYMMDD_NN, maybe with a suffix),
+ * 2 for an archive (Out_YYMMDD.gz), 3 for an archive index
+ * (Out_YYMMDD.idx), 4 for a manifest (Out_YYMMDD_NN.json), 5 for a
+ * manifest's temporary file (.Out_YYMMDD_NN.json.PID) and 0 for anything
+ * else.  Fills in *day.
+ */
+static int
+gc_parse(const char *name, unsigned *day)
+{
+    size_t l = strlen(opfx), ml = strlen(msfx), nl;
+    unsigned d = 0;
+    const char *m;
+    int i;
+
+    if (name[0] == '.') {
+        m = strstr(name, msfx);
+        return((gc_parse(name + 1, day) == 1 && m && m[ml] == '.') ? 5 : 0);
+    }
+    if (strncmp(name, opfx, l)) return(0);
+    name += l;
+    for (i = 0; i < 6; ++i) {
+        if (name[i] < '0' || name[i] > '9') return(0);
+        d = d * 10 + (name[i] - '0');
+    }
+    name += 6;
+    *day = d;
+    if (name[0] == '_' && name[1] >= '0' && name[1] <= '9') {
+        nl = strlen(name);
+        return((nl > ml && !strcmp(name + nl - ml, msfx)) ? 4 : 1);
+    }
+    if (!strcmp(name, ".gz")) return(2);
+    if (!strcmp(name, ".idx")) return(3);
+    return(0);
+}
+
+/* gc_dayend(): Time at which the day YYMMDD ends. */
+static time_t
+gc_dayend(unsigned day)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof tm);
+    tm.tm_year = 100 + day / 10000;
+    tm.tm_mon = (day / 100) % 100 - 1;
+    tm.tm_mday = day % 100 + 1;
+    tm.tm_isdst = -1;
+    return(mktime(&tm));
+}
+
+/* gc_cmp(): qsort() comparison to put gcent's oldest first */
+static int
+gc_cmp(const void *a, const void *b)
+{
+    const struct gcent *ea = a, *eb = b;
+
+    if (ea->when != eb->when) return((ea->when < eb->when) ? -1 : 1);
+    return(strcmp(ea->name, eb->name));
+}
+
+/* gc_free(): Free what gc_scan() returned. */
+static void
+gc_free(struct gcent *ents, size_t nents)
+{
+    size_t i;
+
+    for (i = 0; i < nents; ++i) free(ents[i].name);
+    free(ents);
+}
+
+/* gc_scan(): Find the output files & archives in 'dir' and list them,
+ * oldest first, in a newly allocated array.  Removes abandoned manifest
+ * temporary files along the way.  On success returns >= 0; on failure < 0.
+ */
+static int
+gc_scan(const char *dir, struct gcent **entsp, size_t *nentsp)
+{
+    char buf[2048];
+    DIR *d;
+    struct dirent *e;
+    struct stat sb;
+    struct gcent *ents = NULL, *ent, *nents2;
+    size_t nents = 0, aents = 0, i;
+    unsigned day;
+    int kind;
+    time_t now = time(NULL);
+
+    d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return(-1);
+    }
+    while ((e = readdir(d)) != NULL) {
+        kind = gc_parse(e->d_name, &day);
+        if (!kind) continue;
+        snprintf(buf, sizeof buf, "%s/%s", dir, e->d_name);
+        if (lstat(buf, &sb) < 0 || (sb.st_mode & S_IFMT) != S_IFREG) continue;
+        if (kind == 5) {
+            /* Writing a manifest takes moments; this one was abandoned
+             * by a logrun that died.
+             */
+            if (sb.st_mtime < now - gc_stale && unlink(buf) < 0) perror(buf);
+            continue;
+        }
+
+        /* an archive's two files share one entry */
+        ent = NULL;
+        for (i = 0; (kind == 2 || kind == 3) && i < nents; ++i) {
+            if (ents[i].archive && ents[i].day == day) {
+                ent = &ents[i];
+                break;
+            }
+        }
+        if (!ent) {
+            if (nents >= aents) {
+                aents = aents ? aents * 2 : 64;
+                nents2 = realloc(ents, aents * sizeof(*ents));
+                if (!nents2) {
+                    fprintf(stderr, "%s: out of memory\n", progname);
+                    closedir(d);
+                    gc_free(ents, nents);
+                    return(-1);
+                }
+                ents = nents2;
+            }
+            ent = &ents[nents];
+            memset(ent, 0, sizeof *ent);
+            ent->archive = (kind == 2 || kind == 3);
+            ent->manifest = (kind == 4);
+            ent->day = day;
+            if (ent->archive) {
+                snprintf(buf, sizeof buf, "%s%06u", opfx, day);
+                ent->when = gc_dayend(day);
+            } else {
+                snprintf(buf, sizeof buf, "%s", e->d_name);
+                ent->when = sb.st_mtime;
+            }
+            ent->name = strdup(buf);
+            if (!ent->name) {
+                fprintf(stderr, "%s: out of memory\n", progname);
+                closedir(d);
+                gc_free(ents, nents);
+                return(-1);
+            }
+            ++nents;
+        }
+        ent->size += sb.st_size;
+    }
+    closedir(d);
+
+    if (nents) qsort(ents, nents, sizeof(*ents), gc_cmp);
+    *entsp = ents;
+    *nentsp = nents;
+    return(0);
+}
+
+/* gc_remove(): Remove an output file or archive.  An output file is
+ * left alone if a running logrun has it locked.  Returns 0 if it was
+ * removed, negative if not.
+ */
+static int
+gc_remove(const char *dir, struct gcent *ent)
+{
+    char buf[2048];
+    int fd, rv;
+
+    if (ent->archive) {
+        snprintf(buf, sizeof buf, "%s/%s.idx", dir, ent->name);
+        if (unlink(buf) < 0 && errno != ENOENT) {
+            perror(buf);
+            return(-1);
+        }
+        snprintf(buf, sizeof buf, "%s/%s.gz", dir, ent->name);
+        if (unlink(buf) < 0 && errno != ENOENT) {
+            perror(buf);
+            return(-1);
+        }
+        return(0);
+    }
+
+    snprintf(buf, sizeof buf, "%s/%s", dir, ent->name);
+    fd = open(buf, O_RDONLY);
+    if (fd < 0) return(-1);
+    if (fdlock(fd, F_RDLCK, 0) < 0) {
+        /* in use, or can't tell */
+        close(fd);
+        return(-1);
+    }
+    rv = unlink(buf);
+    if (rv < 0) perror(buf);
+    close(fd);
+    return(rv);
+}
+
+/* gc_command(): Find the command line in the header of an output file
+ * (open as 'fd') and put it in buf[], for the archive index.  Only the
+ * header is looked at, that is up to its second 'bar' line, so that the
+ * command's own output can't be mistaken for it.
+ */
+static void
+gc_command(int fd, char *buf, int buflen)
+{
+    static const char *tags[] = { "SHELL COMMAND: ", "COMMAND LINE: " };
+    char hdr[4096], *s, *e;
+    ssize_t l;
+    int i, bars = 0;
+
+    buf[0] = '\0';
+    l = pread(fd, hdr, sizeof(hdr) - 1, 0);
+    if (l <= 0) return;
+    hdr[l] = '\0';
+    for (s = hdr; *s && bars < 2; s = *e ? e + 1 : e) {
+        e = strchr(s, '\n');
+        if (!e) e = s + strlen(s);
+        if (e - s == strlen(bar) && !strncmp(s, bar, e - s)) {
+            ++bars;
+            continue;
+        }
+        for (i = 0; i < sizeof(tags) / sizeof(tags[0]); ++i) {
+            if (strncmp(s, tags[i], strlen(tags[i]))) continue;
+            s += strlen(tags[i]);
+            snprintf(buf, buflen, "%.*s", (int)(e - s), s);
+            for (s = buf; *s; ++s) {
+                if (*s == '\t' || *s == '\r') *s = ' ';
+            }
+            return;
+        }
+    }
+}
+
+/* gc_pack(): Pack an output file into its day's archive, then remove it.
+ * Left alone if a running logrun has it locked.  Returns 0 if it was
+ * packed, negative if not.
+ */
+static int
+gc_pack(const char *dir, struct gcent *ent)
+{
+    char path[2048], apath[2048], ipath[2048], line[2048], cmd[1024];
+    char rec[4096];
+    int fd, afd, ifd, l, xstatus = 0, rv = -1, indexed, partial = 0;
+    FILE *ifp;
+    struct stat sb, asb, isb;
+    off_t start = 0, end = 0;
+    long long off, len, osize, omtime;
+    int ntabs;
+    pid_t pid;
+    char *s;
+
+    snprintf(path, sizeof path, "%s/%s", dir, ent->name);
+    snprintf(apath, sizeof apath, "%s/%s%06u.gz", dir, opfx, ent->day);
+    snprintf(ipath, sizeof ipath, "%s/%s%06u.idx", dir, opfx, ent->day);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return(-1);
+    if (fdlock(fd, F_RDLCK, 0) < 0 || fstat(fd, &sb) < 0) {
+        close(fd);
+        return(-1);
+    }
+
+    /* See what the index already has.  The archive ends where its last
+     * entry does; anything past that is left over from an interrupted
+     * pack.  And if this file is already listed, it was packed but not
+     * removed.  Entries are only believed if they're complete lines with
+     * all their fields, and their data is all there in the archive; others
+     * are ignored, and if this file's was one of them it gets packed again.
+     */
+    if (stat(apath, &asb) < 0) {
+        if (errno != ENOENT) {
+            perror(apath);
+            close(fd);
+            return(-1);
+        }
+        asb.st_size = 0;
+    }
+    ifp = fopen(ipath, "r");
+    indexed = (ifp != NULL);
+    if (!ifp && errno != ENOENT) {
+        perror(ipath);
+        close(fd);
+        return(-1);
+    }
+    while (ifp && fgets(line, sizeof line, ifp)) {
+        partial = !strchr(line, '\n');
+        if (line[0] == '#' || partial) continue;
+        for (ntabs = 0, s = line; (s = strchr(s, '\t')) != NULL; ++s) ++ntabs;
+        s = strchr(line, '\t');
+        if (ntabs != 5 || sscanf(s, "\t%lld\t%lld\t%lld\t%lld",
+                                 &off, &len, &osize, &omtime) != 4) {
+            continue; /* not a whole entry */
+        }
+        if (off < 0 || len <= 0 || off + len > asb.st_size) continue;
+        if (off + len > end) end = off + len;
+        *s = '\0';
+        if (!strcmp(line, ent->name)) {
+            fclose(ifp);
+            rv = unlink(path);
+            if (rv < 0) perror(path);
+            close(fd);
+            return(rv);
+        }
+    }
+    if (ifp) fclose(ifp);
+
+    afd = open(apath, O_WRONLY | O_CREAT, 0660);
+    if (afd < 0 || fstat(afd, &asb) < 0) {
+        perror(apath);
+        if (afd >= 0) close(afd);
+        close(fd);
+        return(-1);
+    }
+    if (!indexed && asb.st_size > 0) {
+        /* Without its index, there's no telling what in the archive is
+         * good; leave it be rather than risk losing any of it.
+         */
+        fprintf(stderr, "%s: %s has no index %s; not adding to it\n",
+                progname, apath, ipath);
+        close(afd);
+        close(fd);
+        return(-1);
+    }
+    start = (asb.st_size > end) ? end : asb.st_size;
+    if (ftruncate(afd, start) < 0 || lseek(afd, start, SEEK_SET) < 0) {
+        perror(apath);
+        close(afd);
+        close(fd);
+        return(-1);
+    }
+    gc_command(fd, cmd, sizeof cmd);
+
+    /* compress it onto the end of the archive */
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+    } else if (pid == 0) {
+        dup2(fd, STDIN_FILENO);
+        dup2(afd, STDOUT_FILENO);
+        execlp(gzip, gzip, "-c", "-n", (char *)NULL);
+        fprintf(stderr, "execlp(%s) failed: %s\n", gzip, strerror(errno));
+        _exit(127);
+    } else {
+        while (waitpid(pid, &xstatus, 0) < 0 && errno == EINTR)
+            ;
+        if (WIFEXITED(xstatus) && WEXITSTATUS(xstatus) == 0 &&
+            fsync(afd) >= 0 && fstat(afd, &asb) >= 0) {
+            rv = 0;
+        } else {
+            fprintf(stderr, "%s: unable to pack %s\n", progname, path);
+        }
+    }
+
+    /* Record it in the index, and only then remove the original.  It's
+     * one write(), so that if it fails, whatever part of it made it in
+     * can be taken back out: the index must never list a file that the
+     * archive doesn't hold.
+     */
+    if (rv >= 0) {
+        ifd = open(ipath, O_WRONLY | O_APPEND | O_CREAT, 0660);
+        if (ifd < 0 || fstat(ifd, &isb) < 0) {
+            perror(ipath);
+            if (ifd >= 0) close(ifd);
+            rv = -1;
+        } else {
+            /* after a partial line, start a new one */
+            l = snprintf(rec, sizeof rec, "%s%s\t%lld\t%lld\t%lld\t%lld\t%s\n",
+                         (isb.st_size == 0) ?
+                         "# name\toffset\tlength\tsize\tmtime\tcommand\n" :
+                         partial ? "\n" : "",
+                         ent->name, (long long)start,
+                         (long long)(asb.st_size - start),
+                         (long long)sb.st_size, (long long)sb.st_mtime, cmd);
+            if (l < 0 || l >= sizeof(rec) || write(ifd, rec, l) != l ||
+                fsync(ifd) < 0) {
+                perror(ipath);
+                rv = -1;
+                if (ftruncate(ifd, isb.st_size) < 0) perror(ipath);
+            }
+            close(ifd);
+        }
+    }
+    if (rv >= 0) {
+        rv = unlink(path);
+        if (rv < 0) perror(path);
+    } else if (ftruncate(afd, start) < 0) {
+        perror(apath);
+    }
+    close(afd);
+    close(fd);
+    return(rv);
+}
+
+/* gc_lowprio(): Lower this process's CPU & I/O priority, so cleanup
+ * doesn't get in the way of anything else.
+ */
+static void
+gc_lowprio(void)
+{
+    errno = 0;
+    if (nice(19) < 0 && errno) {
+        /* not important */
+    }
+#ifdef HAVE_IOPRIO_SET
+    /* IOPRIO_WHO_PROCESS, this process, IOPRIO_CLASS_IDLE */
+    syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+}
+
+/* gc_run(): Clean up the output directory 'dir' according to 'conf'.
+ * If 'verbose' is nonzero, tell what's being done.  If 'interval' is
+ * nonzero, skip it if the last cleanup was less than that many seconds ago.
+ * Only one cleanup runs in a directory at a time; others are skipped.
+ * On success returns >= 0; on failure < 0.
+ */
+static int
+gc_run(const char *dir, struct gcconf *conf, int verbose, int interval)
+{
+    char buf[2048];
+    struct gcent *ents = NULL;
+    size_t nents = 0, i;
+    unsigned nremoved = 0, npacked = 0, today;
+    off_t total = 0;
+    struct stat sb;
+    time_t now;
+    struct tm *tm;
+    int lfd, rv = 0;
+
+    /* lock out other cleanups */
+    snprintf(buf, sizeof buf, "%s/%s", dir, gclock);
+    lfd = open(buf, O_RDWR | O_CREAT, 0660);
+    if (lfd < 0) {
+        perror(buf);
+        return(-1);
+    }
+    if (fdlock(lfd, F_WRLCK, 0) < 0) {
+        if (verbose) fprintf(stderr, "%s: cleanup already in progress\n", dir);
+        close(lfd);
+        return(0);
+    }
+    now = time(NULL);
+    if (interval && fstat(lfd, &sb) >= 0 && sb.st_size > 0 &&
+        sb.st_mtime <= now && now - sb.st_mtime < interval) {
+        close(lfd);
+        return(0);
+    }
+    tm = localtime(&now);
+    today = tm ? ((tm->tm_year % 100) * 10000 + (tm->tm_mon + 1) * 100 +
+                  tm->tm_mday) : 0;
+    gc_lowprio();
+
+    if (gc_scan(dir, &ents, &nents) < 0) {
+        close(lfd);
+        return(-1);
+    }
+
+    /* remove what's too old */
+    for (i = 0; conf->maxage && i < nents; ++i) {
+        if (ents[i].when >= now - conf->maxage) break; /* the rest are newer */
+        if (gc_remove(dir, &ents[i]) >= 0) {
+            if (verbose) fprintf(stderr, "removed %s/%s\n", dir, ents[i].name);
+            ents[i].gone = 1;
+            ++nremoved;
+        }
+    }
+
+    /* pack what's old enough, except today's, so mkfile() numbers
+     * stay unique
+     */
+    for (i = 0; conf->packafter && i < nents; ++i) {
+        if (ents[i].when >= now - conf->packafter) break;
+        if (ents[i].gone || ents[i].archive || ents[i].manifest ||
+            ents[i].day == today) {
+            continue;
+        }
+        if (gc_pack(dir, &ents[i]) >= 0) {
+            if (verbose) fprintf(stderr, "packed %s/%s\n", dir, ents[i].name);
+            ents[i].gone = 1;
+            ++npacked;
+        }
+    }
+    if (npacked) {
+        /* sizes of the archives have changed */
+        gc_free(ents, nents);
+        ents = NULL;
+        nents = 0;
+        if (gc_scan(dir, &ents, &nents) < 0) rv = -1;
+    }
+
+    /* remove the oldest until it all fits in the budget */
+    for (i = 0; i < nents; ++i) {
+        if (!ents[i].gone) total += ents[i].size;
+    }
+    for (i = 0; conf->maxsize && i < nents && total > conf->maxsize; ++i) {
+        if (ents[i].gone) continue;
+        if (gc_remove(dir, &ents[i]) >= 0) {
+            if (verbose) fprintf(stderr, "removed %s/%s\n", dir, ents[i].name);
+            ents[i].gone = 1;
+            total -= ents[i].size;
+            ++nremoved;
+        }
+    }
+    gc_free(ents, nents);
+
+    if (verbose) {
+        fprintf(stderr, "%s: cleanup of %s: removed %u, packed %u,"
+                " %lld bytes remain\n",
+                progname, dir, nremoved, npacked, (long long)total);
+    }
+
+    /* note when this was done, for 'interval' */
+    snprintf(buf, sizeof buf, "%lld\n", (long long)now);
+    if (ftruncate(lfd, 0) < 0 ||
+        pwrite(lfd, buf, strlen(buf), 0) != (ssize_t)strlen(buf)) {
+        perror(gclock);
+    }
+    close(lfd);
+    return(rv);
+}
+
+/* gc_background(): Run gc_run() in a detached process, at most once every
+ * gc_interval seconds, and without output.  Doesn't wait for it.
+ */
+static void
+gc_background(const char *dir, struct gcconf *conf)
+{
+    pid_t pid;
+    int fd;
+
+    pid = fork();
+    if (pid != 0) return; /* parent, or fork failed: either way, carry on */
+
+    /* child: get out of the way of the terminal & whatever reads our output */
+    setsid();
+    fd = open("/dev/null", O_RDWR);
+    if (fd >= 0) {
+        dup2(fd, STDIN_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        if (fd > STDERR_FILENO) close(fd);
+    }
+    _exit((gc_run(dir, conf, 0, gc_interval) < 0) ? 1 : 0);
+}
+
+/* Relaying the child's output.  Reads grow with the bursts of output
+ * seen, and shrink again when they get small, so a fast producer is
+ * read in big chunks while a trickle is still passed along as soon as
+ * it comes.  The pipe's capacity grows along with the reads, where
+ * that's supported (F_SETPIPE_SZ), up to $LOGRUN_PIPE_SIZE.
+ *
+ * Read buffers come in size classes relay_min << (2 * class), and there's
+ * one reusable buffer per class, shared by stdout & stderr since they're
+ * only used one at a time.  They're aligned on relay_min (4kB, a page on
+ * most systems), except relay_buf0, the fallback if even the smallest
+ * can't be allocated.
+ */
+
+#define RELAY_CLASSES 5 /* 4kB, 16kB, 64kB, 256kB, 1MB */
+
+/* relay: size state for one of the child's outputs */
+struct relay {
+    int cls; /* size class to read with */
+    int small; /* how many reads in a row were small for that class */
+    long pipecap; /* pipe capacity as far as we know; 0 if unknown */
+    int pipefixed; /* set once enlarging the pipe has failed */
+};
+
+static char relay_buf0[4096]; /* class 0 buffer of last resort */
+static char *relay_pool[RELAY_CLASSES];
+static int relay_maxcls = 0; /* largest class to use */
+static long relay_pipemax = 0; /* largest pipe capacity to ask for */
+
+/* relay_init(): Set up for relaying, with a limit of 'limit' bytes on
+ * pipe capacity and reads.
+ */
+static void
+relay_init(unsigned long long limit)
+{
+    relay_maxcls = 0;
+    while (relay_maxcls + 1 < RELAY_CLASSES &&
+           ((unsigned long long)relay_min << (2 * (relay_maxcls + 1))) <= limit)
+        ++relay_maxcls;
+    relay_pipemax = (limit > LONG_MAX) ? LONG_MAX : (long)limit;
+}
+
+/* relay_start(): Initialize 'r' for relaying from pipe 'fd'. */
+static void
+relay_start(struct relay *r, int fd)
+{
+    memset(r, 0, sizeof *r);
+#ifdef HAVE_F_SETPIPE_SZ
+    r->pipecap = fcntl(fd, F_GETPIPE_SZ);
+    if (r->pipecap < 0) r->pipecap = 0;
+#endif
+}
+
+/* relay_buf(): Get the buffer to read into for 'r', and its size.  If
+ * one of that size can't be allocated, 'r' drops to a smaller class.
+ */
+static char *
+relay_buf(struct relay *r, int *size)
+{
+    void *p;
+
+    while (!relay_pool[r->cls]) {
+        p = NULL;
+        if (posix_memalign(&p, relay_min, relay_min << (2 * r->cls)) == 0) {
+            relay_pool[r->cls] = p;
+        } else if (r->cls > 0) {
+            --r->cls;
+        } else {
+            relay_pool[0] = relay_buf0;
+        }
+    }
+    *size = relay_min << (2 * r->cls);
+    return(relay_pool[r->cls]);
+}
+
+/* relay_adapt(): After reading 'n' bytes from pipe 'fd' for 'r', adjust
+ * the size of the next read, and the pipe's capacity.
+ */
+static void
+relay_adapt(struct relay *r, int fd, int n)
+{
+    int size = relay_min << (2 * r->cls);
+#ifdef HAVE_F_SETPIPE_SZ
+    long want, got;
+#endif
+
+    if (n >= size && r->cls < relay_maxcls) {
+        /* filled the buffer: there's probably more where that came from */
+        ++r->cls;
+        r->small = 0;
+#ifdef HAVE_F_SETPIPE_SZ
+        want = (long)(relay_min << (2 * r->cls)) * 4;
+        if (want > relay_pipemax) want = relay_pipemax;
+        if (want > r->pipecap && !r->pipefixed) {
+            /* If it fails, probably from a system limit, bigger sizes
+             * would fail too; so don't try again.
+             */
+            got = fcntl(fd, F_SETPIPE_SZ, want);
+            if (got < 0) {
+                r->pipefixed = 1;
+            } else {
+                r->pipecap = got;
+            }
+        }
+#endif
+    } else if (n <= size / 4 && r->cls > 0) {
+        if (++r->small >= relay_patience) {
+            --r->cls;
+            r->small = 0;
+        }
+    } else {
+        r->small = 0;
+    }
+}
+
+/* Run manifests.  Next to each output file, Out_YYMMDD_NN, goes
+ * Out_YYMMDD_NN.json, a small JSON object telling about the run (see
+ * manifest_write() for what's in it), so other programs needn't dig it
+ * out of the end of the output file.  It's written to a temporary file
+ * and renamed into place, so whatever reads it sees all or nothing.
+ */
+
+/* manifest: what's known about a run, for manifest_write() */
+struct manifest {
+    const char *path; /* output file */
+    int execit; /* -x: argv run directly instead of through the shell */
+    char **argv; /* command, 'argc' elements */
+    int argc;
+    const char *cmd; /* command as given to the shell */
+    const char *cwd; /* working directory; NULL if unknown */
+    ustime_t tstart, tend; /* start & end times */
+    int xstatus; /* status from waitpid() */
+    unsigned long long nout, nerr; /* bytes of stdout & stderr */
+};
+
+/* utf8_len(): If a valid UTF-8 sequence for a non-ASCII character starts
+ * at 's', return its length in bytes; otherwise 0.
+ */
+static int
+utf8_len(const unsigned char *s)
+{
+    int len, i;
+    unsigned char lo = 0x80, hi = 0xbf; /* range of the second byte */
+
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        len = 2;
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        len = 3;
+        if (s[0] == 0xe0) lo = 0xa0; /* no overlong forms */
+        if (s[0] == 0xed) hi = 0x9f; /* no surrogates */
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        len = 4;
+        if (s[0] == 0xf0) lo = 0x90; /* no overlong forms */
+        if (s[0] == 0xf4) hi = 0x8f; /* nothing past U+10FFFF */
+    } else {
+        return(0);
+    }
+    if (s[1] < lo || s[1] > hi) return(0);
+    for (i = 2; i < len; ++i) {
+        if (s[i] < 0x80 || s[i] > 0xbf) return(0);
+    }
+    return(len);
+}
+
+/* json_str(): Write string 's' to 'f' as a JSON string; or null if NULL.
+ * Bytes that aren't valid UTF-8 are taken as Latin-1, so that the
+ * result is always valid JSON.
+ */
+static void
+json_str(FILE *f, const char *s)
+{
+    int l;
+
+    if (!s) {
+        fputs("null", f);
+        return;
+    }
+    putc('"', f);
+    for (; *s; ++s) {
+        switch (*s) {
+        case '"': fputs("\\\"", f); break;
+        case '\\': fputs("\\\\", f); break;
+        case '\n': fputs("\\n", f); break;
+        case '\r': fputs("\\r", f); break;
+        case '\t': fputs("\\t", f); break;
+        default:
+            if ((unsigned char)*s < 0x20) {
+                fprintf(f, "\\u%04x", (unsigned)(unsigned char)*s);
+            } else if ((unsigned char)*s < 0x80) {
+                putc(*s, f);
+            } else if ((l = utf8_len((const unsigned char *)s)) > 0) {
+                fwrite(s, 1, l, f);
+                s += l - 1;
+            } else {
+                fprintf(f, "\\u%04x", (unsigned)(unsigned char)*s);
+            }
+        }
+    }
+    putc('"', f);
+}
+
+/* json_time(): Write a time as "NAME": seconds, "NAME_iso": "...". */
+static void
+json_time(FILE *f, const char *name, ustime_t t)
+{
+    time_t tsec = (time_t)(t / 1000000);
+    struct tm *tm = gmtime(&tsec);
+    char buf[64];
+
+    fprintf(f, "  \"%s\": %lld.%06u,\n", name,
+            (long long)(t / 1000000), (unsigned)(t % 1000000));
+    if (!tm || strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%SZ", tm) <= 0) {
+        fprintf(f, "  \"%s_iso\": null,\n", name);
+    } else {
+        fprintf(f, "  \"%s_iso\": \"%s\",\n", name, buf);
+    }
+}
+
+/* manifest_write(): Write the manifest for the run described by 'm'.
+ * On success returns >= 0; on failure < 0, having said why.
+ */
+static int
+manifest_write(const struct manifest *m)
+{
+    char tpath[2048], mpath[2048];
+    const char *base;
+    struct stat sb;
+    FILE *f;
+    int fd, i, rv = 0;
+    ustime_t dt;
+#ifdef HAVE_GETRUSAGE
+    struct rusage ru;
+#endif
+
+    /* Out_YYMMDD_NN.json, and .Out_YYMMDD_NN.json.PID while writing it;
+     * the leading "." keeps mkfile() from seeing that, and cleanup
+     * (gc_scan()) only removes it if it's been abandoned.
+     */
+    base = strrchr(m->path, '/');
+    base = base ? base + 1 : m->path;
+    i = snprintf(mpath, sizeof mpath, "%s%s", m->path, msfx);
+    if (i < 0 || i >= sizeof(mpath)) return(-1);
+    i = snprintf(tpath, sizeof tpath, "%.*s.%s%s.%ld",
+                 (int)(base - m->path), m->path, base, msfx, (long)getpid());
+    if (i < 0 || i >= sizeof(tpath)) return(-1);
+
+    fd = open(tpath, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        perror(tpath);
+        return(-1);
+    }
+    f = fdopen(fd, "w");
+    if (!f) {
+        perror(tpath);
+        close(fd);
+        unlink(tpath);
+        return(-1);
+    }
+
+    fprintf(f, "{\n  \"version\": ");
+    json_str(f, LOGRUN_VERSION);
+    fprintf(f, ",\n  \"log\": ");
+    json_str(f, base);
+    if (stat(m->path, &sb) >= 0) {
+        fprintf(f, ",\n  \"log_size\": %lld,\n", (long long)sb.st_size);
+    } else {
+        fprintf(f, ",\n  \"log_size\": null,\n");
+    }
+    fprintf(f, "  \"mode\": \"%s\",\n  \"command\": ",
+            m->execit ? "exec" : "shell");
+    json_str(f, m->cmd);
+    fprintf(f, ",\n  \"argv\": [");
+    for (i = 0; i < m->argc; ++i) {
+        if (i) fputs(", ", f);
+        json_str(f, m->argv[i]);
+    }
+    fprintf(f, "],\n  \"cwd\": ");
+    json_str(f, m->cwd);
+    fprintf(f, ",\n  \"euid\": %u,\n", (unsigned)geteuid());
+    json_time(f, "start", m->tstart);
+    json_time(f, "end", m->tend);
+    dt = (m->tend < m->tstart) ? 0 : (m->tend - m->tstart);
+    fprintf(f, "  \"elapsed\": %lld.%06u,\n",
+            (long long)(dt / 1000000), (unsigned)(dt % 1000000));
+    if (WIFEXITED(m->xstatus)) {
+        fprintf(f, "  \"exit_status\": %u,\n  \"signal\": null,\n"
+                "  \"signal_text\": null,\n  \"core_dumped\": false,\n",
+                (unsigned)WEXITSTATUS(m->xstatus));
+    } else if (WIFSIGNALED(m->xstatus)) {
+        fprintf(f, "  \"exit_status\": null,\n  \"signal\": %u,\n"
+                "  \"signal_text\": ", (unsigned)WTERMSIG(m->xstatus));
+        json_str(f, strsignal(WTERMSIG(m->xstatus)));
+        fprintf(f, ",\n  \"core_dumped\": %s,\n",
+                WCOREDUMP(m->xstatus) ? "true" : "false");
+    } else {
+        fprintf(f, "  \"exit_status\": null,\n  \"signal\": null,\n"
+                "  \"signal_text\": null,\n  \"core_dumped\": false,\n");
+    }
+    fprintf(f, "  \"stdout_bytes\": %llu,\n  \"stderr_bytes\": %llu,\n",
+            m->nout, m->nerr);
+#ifdef HAVE_GETRUSAGE
+    memset(&ru, 0, sizeof ru);
+    if (getrusage(RUSAGE_CHILDREN, &ru) >= 0) {
+        fprintf(f,
+                "  \"rusage\": {\n"
+                "    \"utime\": %lld.%06u,\n"
+                "    \"stime\": %lld.%06u,\n"
+                "    \"maxrss\": %ld,\n"
+                "    \"ixrss\": %ld,\n"
+                "    \"idrss\": %ld,\n"
+                "    \"isrss\": %ld,\n"
+                "    \"minflt\": %ld,\n"
+                "    \"majflt\": %ld,\n"
+                "    \"nswap\": %ld,\n"
+                "    \"inblock\": %ld,\n"
+                "    \"oublock\": %ld,\n"
+                "    \"msgsnd\": %ld,\n"
+                "    \"msgrcv\": %ld,\n"
+                "    \"nsignals\": %ld,\n"
+                "    \"nvcsw\": %ld,\n"
+                "    \"nivcsw\": %ld\n"
+                "  }\n",
+                (long long)ru.ru_utime.tv_sec, (unsigned)ru.ru_utime.tv_usec,
+                (long long)ru.ru_stime.tv_sec, (unsigned)ru.ru_stime.tv_usec,
+                (long)ru.ru_maxrss, (long)ru.ru_ixrss, (long)ru.ru_idrss,
+                (long)ru.ru_isrss, (long)ru.ru_minflt, (long)ru.ru_majflt,
+                (long)ru.ru_nswap, (long)ru.ru_inblock, (long)ru.ru_oublock,
+                (long)ru.ru_msgsnd, (long)ru.ru_msgrcv, (long)ru.ru_nsignals,
+                (long)ru.ru_nvcsw, (long)ru.ru_nivcsw);
+    } else
+#endif /* HAVE_GETRUSAGE */
+    {
+        fprintf(f, "  \"rusage\": null\n");
+    }
+    fprintf(f, "}\n");
+
+    /* make sure it's all there before it takes the final name */
+    if (fflush(f) != 0 || fsync(fileno(f)) < 0) {
+        perror(tpath);
+        rv = -1;
+    }
+    if (fclose(f) != 0 && rv >= 0) {
+        perror(tpath);
+        rv = -1;
+    }
+    if (rv >= 0 && rename(tpath, mpath) < 0) {
+        perror(mpath);
+        rv = -1;
+    }
+    if (rv < 0) unlink(tpath);
+    return(rv);
+}
+
 /* main program */
 int
 main(int argc, char **argv)
 {
     int execit = 0; /* -x option to bypass shell */
+    int gcmode = 0; /* -C option to clean up instead of running a command */
+    struct gcconf gcconf;
     int doclock = 0; /* -k for time updates every 5 minutes */
     int oc, i, rv;
-    char *dir = NULL, *path = NULL;
+    char *dir = NULL, *path = NULL, *cmd = NULL, *rbuf = relay_buf0;
     char buf[4096];
+    int cmdlen, rsize = sizeof relay_buf0;
+    struct relay rout, rerr, *r = NULL;
+    unsigned long long plimit = pipe_dflt;
+    struct manifest man;
     FILE *fp, *o;
     int xstatus = 0, xstatus1 = 0, xstatus2 = 0;
     pid_t child, reaped;
@@ -364,15 +1414,16 @@ main(int argc, char **argv)
 #ifdef USE_GETOPT_PLUS
                         "+" /* stop option parsing with the first non-option */
 #endif
-                        "d:xg")) >= 0) {
+                        "d:xgC")) >= 0) {
         switch (oc) {
+        case 'C': gcmode = 1; break;
         case 'd': dir = optarg; break;
         case 'g': doclock++; break;
         case 'x': execit = 1; break;
         default: case '?': usage();
         }
     }
-    if (optind >= argc) usage();
+    if (gcmode ? (optind < argc) : (optind >= argc)) usage();
 
     /* figure out where to put the output file */
     if (!dirok(dir)) {
@@ -389,10 +1440,24 @@ main(int argc, char **argv)
         dir = ".";
     }
 
+    /* if asked to clean up the directory, do that instead of a command */
+    if (gcmode) {
+        rv = gc_getconf(&gcconf);
+        if (rv < 0) exit(1);
+        if (rv == 0) {
+            fprintf(stderr, "%s: no cleanup configured; set $%s, $%s"
+                    " or $%s\n", progname, gcage, gcsize, gcpack);
+            exit(0);
+        }
+        exit((gc_run(dir, &gcconf, 1, 0) < 0) ? 1 : 0);
+    }
+
     /* and figure out the actual file name & create it */
     if (mkfile(dir, &path, &fp) < 0) exit(2);
 
     /* write initial "header" information */
+    memset(&man, 0, sizeof man);
+    man.tstart = ustime(NULL);
     fprintf(stderr, "(This output saved to file: %s)\n", path);
     demit(stderr, fp, "%s\n", bar);
     time_emit(stderr, fp, 1, 0, "\n");
@@ -414,7 +1479,9 @@ main(int argc, char **argv)
         }
         demit(stderr, fp, "\n");
     }
-    if (!getcwd(buf, sizeof buf)) {
+    if (getcwd(buf, sizeof buf)) {
+        man.cwd = strdup(buf);
+    } else {
         snprintf(buf, sizeof buf, "Unable to find out: %s",
                  strerror(errno));
     }
@@ -441,12 +1508,22 @@ main(int argc, char **argv)
     }
 
     /* if running command in a shell: format it into a string */
-    if (spacepaste(buf, sizeof buf, argv + optind, argc - optind) < 0) {
-        demit(stderr, fp, "ERROR: command too long for buffer\n");
+    for (cmdlen = 1, i = optind; i < argc; ++i) {
+        cmdlen += strlen(argv[i]) + 1;
+    }
+    cmd = malloc(cmdlen);
+    if (!cmd || spacepaste(cmd, cmdlen, argv + optind, argc - optind) < 0) {
+        demit(stderr, fp, "ERROR: out of memory for command\n");
         fclose(fp);
         exit(1);
     }
 
+    /* prepare to relay the command's output */
+    if (envnum(pipesz, 1, ULLONG_MAX, &plimit) < 0) plimit = pipe_dflt;
+    relay_init(plimit);
+    relay_start(&rout, pout[0]);
+    relay_start(&rerr, perr[0]);
+
     /* in case we're doing 'clock' updates, prepare for them */
     tclocklast = ustime(NULL);
 
@@ -477,10 +1554,10 @@ main(int argc, char **argv)
                     argv[optind], strerror(errno));
         } else {
             /* build a shell command line string and run the shell on it */
-            execl(shell, shell, "-c", buf, NULL);
+            execl(shell, shell, "-c", cmd, NULL);
             rv = (errno != ENOENT) ? 127 : 126;
             fprintf(stderr, "execl(%s -c '%s') failed: %s\n",
-                    shell, buf, strerror(errno));
+                    shell, cmd, strerror(errno));
         }
         _exit(rv);
     } else {
@@ -548,11 +1625,23 @@ main(int argc, char **argv)
             /* There's something to do */
             if (pout[0] >= 0 && FD_ISSET(pout[0], &rfds)) {
                 /* Read from the child's stdout */
-                i = read(pout[0], buf, sizeof buf);
+                r = &rout;
+                rbuf = relay_buf(r, &rsize);
+                i = read(pout[0], rbuf, rsize);
+                if (i > 0) {
+                    man.nout += i;
+                    relay_adapt(r, pout[0], i);
+                }
                 o = stdout;
             } else if (perr[0] >= 0 && FD_ISSET(perr[0], &rfds)) {
                 /* Read from the child's stderr */
-                i = read(perr[0], buf, sizeof buf);
+                r = &rerr;
+                rbuf = relay_buf(r, &rsize);
+                i = read(perr[0], rbuf, rsize);
+                if (i > 0) {
+                    man.nerr += i;
+                    relay_adapt(r, perr[0], i);
+                }
                 o = stderr;
             }
             if (i < 0) {
@@ -565,7 +1654,7 @@ main(int argc, char **argv)
                     continue;
                 } else {
                     /* this shouldn't have happened */
-                    i = snprintf(buf, sizeof buf, "read failed: %s\r\n",
+                    i = snprintf(rbuf, rsize, "read failed: %s\r\n",
                                  strerror(errno));
                     o = stderr;
                     usleep(250000); /* 1/4 second */
@@ -583,8 +1672,8 @@ main(int argc, char **argv)
             }
             if (i > 0) {
                 /* Got something, in the buffer!  Pass it along. */
-                fwrite(buf, 1, i, o);
-                fwrite(buf, 1, i, fp);
+                fwrite(rbuf, 1, i, o);
+                fwrite(rbuf, 1, i, fp);
                 if (o == stdout) fflush(stdout);
             }
         }
@@ -621,6 +1710,7 @@ main(int argc, char **argv)
      * If you want it to accurately detect signals/coredumps, include the
      * "-x" option to get the shell out of the way.
      */
+    man.tend = ustime(NULL);
     demit(stderr, fp, "\n%s\n", bar);
     time_emit(stderr, fp, 0, 0, "\n");
     if (WIFEXITED(xstatus)) {
@@ -639,8 +1729,22 @@ main(int argc, char **argv)
     }
     demit(stderr, fp, "%s\n", bar);
     fclose(fp);
+
+    /* and the machine readable version of all that */
+    man.path = path;
+    man.execit = execit;
+    man.argv = argv + optind;
+    man.argc = argc - optind;
+    man.cmd = cmd;
+    man.xstatus = xstatus;
+    if (manifest_write(&man) < 0) {
+        fprintf(stderr, "(Unable to write manifest for: %s)\n", path);
+    }
     fprintf(stderr, "(This output saved to file: %s)\n", path);
 
+    /* if cleanup is configured, let it happen in the background */
+    if (gc_getconf(&gcconf) > 0) gc_background(dir, &gcconf);
+
     /* and exit */
     return(xstatus2);
 }